@@ -0,0 +1,124 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../line_editor.h"
+#include "../vfs.h"
+
+// Times tab-completion lookups: ExecutableIndex over a synthetic $PATH and
+// find_vfs_users over a synthetic user table.
+// Usage: completion_bench [users] [path_dirs] [executables_per_dir]
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+double elapsed_us(clock_type::time_point start) {
+    return std::chrono::duration<double, std::micro>(clock_type::now() - start).count();
+}
+
+std::string make_scratch_directory() {
+    char path[] = "/tmp/kubsh_completion_XXXXXX";
+    if (::mkdtemp(path) == nullptr) {
+        std::perror("mkdtemp");
+        std::exit(1);
+    }
+    return path;
+}
+
+void create_executable(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_CREAT | O_WRONLY, 0755);
+    if (fd != -1) {
+        ::close(fd);
+    }
+}
+
+int remove_entry(const char* path, const struct stat*, int, struct FTW*) {
+    return ::remove(path);
+}
+
+template <typename Lookup>
+double average_us(int iterations, Lookup lookup) {
+    const auto start = clock_type::now();
+    for (int index = 0; index < iterations; ++index) {
+        lookup(index);
+    }
+    return elapsed_us(start) / iterations;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int user_count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    const int directory_count = argc > 2 ? std::atoi(argv[2]) : 16;
+    const int executables_per_directory = argc > 3 ? std::atoi(argv[3]) : 2500;
+    const int iterations = 10000;
+    const std::size_t limit = 64;
+
+    const std::string scratch = make_scratch_directory();
+
+    std::string path_value;
+    for (int directory = 0; directory < directory_count; ++directory) {
+        const std::string directory_path = scratch + "/bin" + std::to_string(directory);
+        ::mkdir(directory_path.c_str(), 0755);
+
+        for (int index = 0; index < executables_per_directory; ++index) {
+            create_executable(directory_path + "/cmd" + std::to_string(directory) +
+                              "_" + std::to_string(index));
+        }
+        path_value += (path_value.empty() ? "" : ":") + directory_path;
+    }
+    ::setenv("PATH", path_value.c_str(), 1);
+
+    ExecutableIndex executables({"\\q", "\\e", "\\l", "debug"});
+
+    auto start = clock_type::now();
+    executables.complete("cmd", limit);
+    const double cold_us = elapsed_us(start);
+
+    const double warm_us = average_us(iterations, [&](int index) {
+        executables.complete("cmd" + std::to_string(index % directory_count) + "_1", limit);
+    });
+
+    create_executable(scratch + "/bin0/cmd_new");
+    start = clock_type::now();
+    executables.complete("cmd_n", limit);
+    const double rescan_us = elapsed_us(start);
+
+    const std::string passwd_path = scratch + "/passwd";
+    {
+        std::ofstream passwd(passwd_path);
+        for (int index = 0; index < user_count; ++index) {
+            passwd << "user" << index << ":x:" << (1000 + index) << ':'
+                   << (1000 + index) << "::/home/user" << index << ":/bin/bash\n";
+        }
+    }
+    load_vfs_users(passwd_path);
+
+    const double users_all_us = average_us(iterations, [&](int) {
+        find_vfs_users("", limit);
+    });
+    const double users_prefix_us = average_us(iterations, [&](int index) {
+        find_vfs_users("user" + std::to_string(index % 1000), limit);
+    });
+
+    std::cout << "executables:            " << directory_count * executables_per_directory
+              << " in " << directory_count << " directories\n"
+              << "cold complete:          " << cold_us << " us\n"
+              << "warm complete:          " << warm_us << " us\n"
+              << "complete after change:  " << rescan_us << " us\n"
+              << "users:                  " << user_count << '\n'
+              << "find_vfs_users(\"\"):     " << users_all_us << " us\n"
+              << "find_vfs_users(prefix): " << users_prefix_us << " us\n";
+
+    return ::nftw(scratch.c_str(), &remove_entry, 16, FTW_DEPTH | FTW_PHYS) == 0 ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../word_expander.h"
+
+// Compares in-process word expansion with spawning /bin/sh for the same
+// words. Usage: expand_bench [directory] [iterations]
+// Without a directory argument a scratch directory of 10000 files is created
+// and removed again afterwards.
+
+namespace {
+
+std::string make_scratch_directory(int file_count) {
+    char path[] = "/tmp/kubsh_bench_XXXXXX";
+    if (::mkdtemp(path) == nullptr) {
+        std::perror("mkdtemp");
+        std::exit(1);
+    }
+
+    for (int index = 0; index < file_count; ++index) {
+        const char* suffix = index % 2 == 0 ? ".log" : ".txt";
+        std::ofstream(std::string(path) + "/file" + std::to_string(index) + suffix);
+    }
+    return path;
+}
+
+void remove_scratch_directory(const std::string& path, int file_count) {
+    for (int index = 0; index < file_count; ++index) {
+        const char* suffix = index % 2 == 0 ? ".log" : ".txt";
+        ::unlink((path + "/file" + std::to_string(index) + suffix).c_str());
+    }
+    ::rmdir(path.c_str());
+}
+
+void run_shell(const std::string& words) {
+    const pid_t pid = ::fork();
+    if (pid == 0) {
+        const std::string script = "set -- " + words;
+        ::execl("/bin/sh", "sh", "-c", script.c_str(), static_cast<char*>(nullptr));
+        std::_Exit(127);
+    }
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int scratch_file_count = 10000;
+    const bool use_scratch = argc < 2;
+    const std::string directory =
+        use_scratch ? make_scratch_directory(scratch_file_count) : argv[1];
+    const int iterations = argc > 2 ? std::atoi(argv[2]) : 200;
+
+    const std::string words = "$HOME ~/x " + directory + "/*.log";
+
+    using clock = std::chrono::steady_clock;
+    std::vector<std::string> expanded;
+
+    auto start = clock::now();
+    for (int index = 0; index < iterations; ++index) {
+        WordExpander::instance().expand(words, expanded);
+    }
+    const double in_process_us =
+        std::chrono::duration<double, std::micro>(clock::now() - start).count() / iterations;
+
+    start = clock::now();
+    for (int index = 0; index < iterations; ++index) {
+        run_shell(words);
+    }
+    const double shell_us =
+        std::chrono::duration<double, std::micro>(clock::now() - start).count() / iterations;
+
+    std::cout << "words:      " << words << '\n'
+              << "expanded:   " << expanded.size() << " words\n"
+              << "in-process: " << in_process_us << " us/iteration\n"
+              << "/bin/sh:    " << shell_us << " us/iteration\n";
+
+    if (use_scratch) {
+        remove_scratch_directory(directory, scratch_file_count);
+    }
+    return 0;
+}
@@ -0,0 +1,690 @@
+#include "line_editor.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "vfs.h"
+
+namespace {
+
+const std::size_t kCompletionListLimit = 64;
+
+bool starts_with(const std::string& value, const std::string& prefix) {
+    return value.compare(0, prefix.size(), prefix) == 0;
+}
+
+std::string common_prefix_of(const std::string& first, const std::string& second) {
+    std::size_t length = 0;
+    while (length < first.size() && length < second.size() &&
+           first[length] == second[length]) {
+        ++length;
+    }
+    return first.substr(0, length);
+}
+
+// Candidates must be sorted: the common prefix of a sorted range is the
+// common prefix of its first and last elements.
+template <typename Iterator>
+Completion collect_sorted_range(Iterator first, Iterator last, std::size_t limit) {
+    Completion completion;
+    if (first == last) {
+        return completion;
+    }
+
+    completion.common_prefix = common_prefix_of(*first, *std::prev(last));
+    for (auto it = first; it != last; ++it) {
+        if (completion.candidates.size() == limit) {
+            completion.truncated = true;
+            break;
+        }
+        completion.candidates.push_back(*it);
+    }
+    return completion;
+}
+
+bool is_utf8_continuation(char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+// Cursor motion and deletion step over whole UTF-8 sequences.
+std::size_t previous_char_start(const std::string& text, std::size_t position) {
+    if (position == 0) {
+        return 0;
+    }
+    --position;
+    while (position > 0 && is_utf8_continuation(text[position])) {
+        --position;
+    }
+    return position;
+}
+
+std::size_t next_char_end(const std::string& text, std::size_t position) {
+    if (position >= text.size()) {
+        return text.size();
+    }
+    ++position;
+    while (position < text.size() && is_utf8_continuation(text[position])) {
+        ++position;
+    }
+    return position;
+}
+
+// Terminal columns taken by the first length bytes, one per code point.
+std::size_t display_width(const std::string& text, std::size_t length) {
+    std::size_t width = 0;
+    for (std::size_t index = 0; index < length && index < text.size(); ++index) {
+        if (!is_utf8_continuation(text[index])) {
+            ++width;
+        }
+    }
+    return width;
+}
+
+bool needs_escape(char c) {
+    return std::strchr(" \t'\"\\$*?[`", c) != nullptr;
+}
+
+// A leading '~' is escaped too, otherwise it would be tilde-expanded.
+std::string escape_word(const std::string& word) {
+    std::string escaped;
+    for (const char c : word) {
+        if (needs_escape(c) || (escaped.empty() && c == '~')) {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+std::string unescape_word(const std::string& word) {
+    std::string unescaped;
+    for (std::size_t index = 0; index < word.size(); ++index) {
+        if (word[index] == '\\' && index + 1 < word.size()) {
+            ++index;
+        }
+        unescaped += word[index];
+    }
+    return unescaped;
+}
+
+} // namespace
+
+ExecutableIndex::ExecutableIndex(std::vector<std::string> builtins)
+    : builtins_(std::move(builtins)) {}
+
+Completion ExecutableIndex::complete(const std::string& prefix, std::size_t limit) {
+    refresh();
+
+    const auto first = std::lower_bound(names_.begin(), names_.end(), prefix);
+    const auto last = std::partition_point(
+        first, names_.end(),
+        [&prefix](const std::string& name) { return starts_with(name, prefix); });
+
+    return collect_sorted_range(first, last, limit);
+}
+
+void ExecutableIndex::refresh() {
+    const char* path_env = std::getenv("PATH");
+    const std::string path_value = path_env != nullptr ? path_env : "";
+
+    bool changed = names_.empty();
+
+    if (path_value != path_value_ || directories_.empty()) {
+        path_value_ = path_value;
+        directories_.clear();
+
+        std::size_t start = 0;
+        while (start <= path_value_.size()) {
+            std::size_t end = path_value_.find(':', start);
+            if (end == std::string::npos) {
+                end = path_value_.size();
+            }
+
+            Directory directory;
+            directory.path = path_value_.substr(start, end - start);
+            if (directory.path.empty()) {
+                directory.path = ".";
+            }
+            directories_.push_back(std::move(directory));
+
+            start = end + 1;
+        }
+        changed = true;
+    }
+
+    for (auto& directory : directories_) {
+        struct stat st;
+        if (::stat(directory.path.c_str(), &st) != 0) {
+            if (directory.scanned) {
+                directory.scanned = false;
+                directory.names.clear();
+                changed = true;
+            }
+            continue;
+        }
+
+        if (!directory.scanned ||
+            st.st_mtim.tv_sec != directory.mtime.tv_sec ||
+            st.st_mtim.tv_nsec != directory.mtime.tv_nsec) {
+            directory.mtime = st.st_mtim;
+            scan_directory(directory);
+            directory.scanned = true;
+            changed = true;
+        }
+    }
+
+    if (!changed) {
+        return;
+    }
+
+    // Directory listings are kept sorted, so rebuilding is a merge rather
+    // than a sort of every name on $PATH.
+    std::size_t total = builtins_.size();
+    for (const auto& directory : directories_) {
+        total += directory.names.size();
+    }
+
+    names_ = builtins_;
+    names_.reserve(total);
+    std::sort(names_.begin(), names_.end());
+    for (const auto& directory : directories_) {
+        const auto middle = names_.insert(names_.end(),
+                                          directory.names.begin(),
+                                          directory.names.end());
+        std::inplace_merge(names_.begin(), middle, names_.end());
+    }
+    names_.erase(std::unique(names_.begin(), names_.end()), names_.end());
+}
+
+void ExecutableIndex::scan_directory(Directory& directory) {
+    directory.names.clear();
+
+    DIR* dir = ::opendir(directory.path.c_str());
+    if (dir == nullptr) {
+        return;
+    }
+
+    const int dir_fd = ::dirfd(dir);
+    while (const struct dirent* entry = ::readdir(dir)) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        if (entry->d_type != DT_REG && entry->d_type != DT_LNK &&
+            entry->d_type != DT_UNKNOWN) {
+            continue;
+        }
+        if (::faccessat(dir_fd, entry->d_name, X_OK, 0) == 0) {
+            directory.names.emplace_back(entry->d_name);
+        }
+    }
+
+    ::closedir(dir);
+
+    std::sort(directory.names.begin(), directory.names.end());
+}
+
+LineEditor::LineEditor(std::string prompt)
+    : prompt_(std::move(prompt)),
+      executables_({"\\q", "\\e", "\\l", "debug"}) {}
+
+LineEditor::~LineEditor() {
+    disable_raw_mode();
+}
+
+bool LineEditor::read_line(std::string& line) {
+    if (!::isatty(STDIN_FILENO) || !enable_raw_mode()) {
+        std::cerr << prompt_;
+        return static_cast<bool>(std::getline(std::cin, line));
+    }
+
+    const bool result = read_raw_line(line);
+    disable_raw_mode();
+    return result;
+}
+
+void LineEditor::add_history(const std::string& line) {
+    if (line.empty() || (!history_.empty() && history_.back() == line)) {
+        return;
+    }
+    history_.push_back(line);
+}
+
+bool LineEditor::enable_raw_mode() {
+    if (::tcgetattr(STDIN_FILENO, &original_termios_) == -1) {
+        return false;
+    }
+
+    struct termios raw = original_termios_;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+
+    if (::tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) == -1) {
+        return false;
+    }
+
+    raw_mode_ = true;
+    return true;
+}
+
+void LineEditor::disable_raw_mode() {
+    if (raw_mode_) {
+        ::tcsetattr(STDIN_FILENO, TCSADRAIN, &original_termios_);
+        raw_mode_ = false;
+    }
+}
+
+bool LineEditor::read_raw_line(std::string& line) {
+    buffer_.clear();
+    cursor_ = 0;
+    history_index_ = history_.size();
+    pending_line_.clear();
+
+    refresh_line();
+
+    bool previous_was_tab = false;
+    while (true) {
+        char key = 0;
+        const ssize_t bytes_read = ::read(STDIN_FILENO, &key, 1);
+        if (bytes_read <= 0) {
+            write_out("\r\n");
+            return false;
+        }
+
+        const bool is_tab = key == '\t';
+
+        switch (key) {
+            case '\r':
+            case '\n':
+                write_out("\r\n");
+                line = buffer_;
+                return true;
+
+            case '\t':
+                complete_word(previous_was_tab);
+                break;
+
+            case 3: // Ctrl-C
+                write_out("^C\r\n");
+                buffer_.clear();
+                cursor_ = 0;
+                history_index_ = history_.size();
+                refresh_line();
+                break;
+
+            case 4: // Ctrl-D
+                if (buffer_.empty()) {
+                    write_out("\r\n");
+                    return false;
+                }
+                if (cursor_ < buffer_.size()) {
+                    buffer_.erase(cursor_, next_char_end(buffer_, cursor_) - cursor_);
+                    refresh_line();
+                }
+                break;
+
+            case 127:
+            case 8: // Backspace
+                if (cursor_ > 0) {
+                    const std::size_t start = previous_char_start(buffer_, cursor_);
+                    buffer_.erase(start, cursor_ - start);
+                    cursor_ = start;
+                    refresh_line();
+                }
+                break;
+
+            case 1: // Ctrl-A
+                cursor_ = 0;
+                refresh_line();
+                break;
+
+            case 5: // Ctrl-E
+                cursor_ = buffer_.size();
+                refresh_line();
+                break;
+
+            case 11: // Ctrl-K
+                buffer_.erase(cursor_);
+                refresh_line();
+                break;
+
+            case 21: // Ctrl-U
+                buffer_.erase(0, cursor_);
+                cursor_ = 0;
+                refresh_line();
+                break;
+
+            case 23: { // Ctrl-W
+                std::size_t start = cursor_;
+                while (start > 0 && buffer_[start - 1] == ' ') {
+                    --start;
+                }
+                while (start > 0 && buffer_[start - 1] != ' ') {
+                    --start;
+                }
+                buffer_.erase(start, cursor_ - start);
+                cursor_ = start;
+                refresh_line();
+                break;
+            }
+
+            case 12: // Ctrl-L
+                write_out("\x1b[H\x1b[2J");
+                refresh_line();
+                break;
+
+            case 16: // Ctrl-P
+                show_history_entry(history_index_ - 1);
+                break;
+
+            case 14: // Ctrl-N
+                show_history_entry(history_index_ + 1);
+                break;
+
+            case 27: // Escape sequence
+                handle_escape_sequence();
+                break;
+
+            default:
+                if (static_cast<unsigned char>(key) >= 32) {
+                    buffer_.insert(cursor_++, 1, key);
+                    refresh_line();
+                }
+                break;
+        }
+
+        previous_was_tab = is_tab;
+    }
+}
+
+// Reads the rest of an ESC sequence. CSI sequences run until a final byte in
+// 0x40-0x7E; unrecognised ones are consumed and ignored.
+void LineEditor::handle_escape_sequence() {
+    char introducer = 0;
+    if (::read(STDIN_FILENO, &introducer, 1) != 1) {
+        return;
+    }
+
+    std::string parameters;
+    char final_byte = 0;
+
+    if (introducer == 'O') {
+        if (::read(STDIN_FILENO, &final_byte, 1) != 1) {
+            return;
+        }
+    } else if (introducer == '[') {
+        while (true) {
+            char c = 0;
+            if (::read(STDIN_FILENO, &c, 1) != 1) {
+                return;
+            }
+            if (c >= 0x40 && c <= 0x7E) {
+                final_byte = c;
+                break;
+            }
+            parameters += c;
+        }
+    } else {
+        return;
+    }
+
+    // "1;5C" carries a modifier: 5 is Ctrl, 3 is Alt.
+    const std::size_t separator = parameters.find(';');
+    const std::string key_code = parameters.substr(0, separator);
+    const std::string modifier =
+        separator == std::string::npos ? "" : parameters.substr(separator + 1);
+    const bool word_motion = modifier == "5" || modifier == "3";
+
+    switch (final_byte) {
+        case 'A':
+            show_history_entry(history_index_ - 1);
+            break;
+        case 'B':
+            show_history_entry(history_index_ + 1);
+            break;
+        case 'C':
+            if (word_motion) {
+                while (cursor_ < buffer_.size() && buffer_[cursor_] == ' ') {
+                    ++cursor_;
+                }
+                while (cursor_ < buffer_.size() && buffer_[cursor_] != ' ') {
+                    ++cursor_;
+                }
+            } else {
+                cursor_ = next_char_end(buffer_, cursor_);
+            }
+            refresh_line();
+            break;
+        case 'D':
+            if (word_motion) {
+                while (cursor_ > 0 && buffer_[cursor_ - 1] == ' ') {
+                    --cursor_;
+                }
+                while (cursor_ > 0 && buffer_[cursor_ - 1] != ' ') {
+                    --cursor_;
+                }
+            } else {
+                cursor_ = previous_char_start(buffer_, cursor_);
+            }
+            refresh_line();
+            break;
+        case 'H':
+            cursor_ = 0;
+            refresh_line();
+            break;
+        case 'F':
+            cursor_ = buffer_.size();
+            refresh_line();
+            break;
+        case '~':
+            if (key_code == "3" && cursor_ < buffer_.size()) {
+                buffer_.erase(cursor_, next_char_end(buffer_, cursor_) - cursor_);
+            } else if (key_code == "1" || key_code == "7") {
+                cursor_ = 0;
+            } else if (key_code == "4" || key_code == "8") {
+                cursor_ = buffer_.size();
+            }
+            refresh_line();
+            break;
+        default:
+            break;
+    }
+}
+
+// The line is kept on a single terminal row: when prompt and buffer do not
+// fit, the visible part of the buffer scrolls horizontally with the cursor.
+void LineEditor::refresh_line() const {
+    const std::size_t prompt_width = display_width(prompt_, prompt_.size());
+    const std::size_t columns = terminal_columns();
+    const std::size_t available =
+        columns > prompt_width + 1 ? columns - prompt_width - 1 : 1;
+
+    std::size_t first = 0;
+    std::size_t cursor_width = display_width(buffer_, cursor_);
+    while (cursor_width >= available) {
+        first = next_char_end(buffer_, first);
+        --cursor_width;
+    }
+
+    std::size_t last = first;
+    for (std::size_t width = 0; width < available && last < buffer_.size(); ++width) {
+        last = next_char_end(buffer_, last);
+    }
+
+    std::string output =
+        "\r" + prompt_ + buffer_.substr(first, last - first) + "\x1b[0K\r";
+
+    const std::size_t column = prompt_width + cursor_width;
+    if (column > 0) {
+        output += "\x1b[" + std::to_string(column) + "C";
+    }
+
+    write_out(output);
+}
+
+// Index history_.size() is the line being edited before navigation began.
+void LineEditor::show_history_entry(std::size_t index) {
+    if (index > history_.size()) {
+        return;
+    }
+
+    if (history_index_ == history_.size()) {
+        pending_line_ = buffer_;
+    }
+
+    history_index_ = index;
+    buffer_ = index == history_.size() ? pending_line_ : history_[index];
+    cursor_ = buffer_.size();
+    refresh_line();
+}
+
+// Completed text is backslash-escaped so that WordExpander reads it back as
+// the same single word; escaped spaces do not end the word being completed.
+void LineEditor::complete_word(bool list_candidates) {
+    std::size_t word_start = 0;
+    for (std::size_t index = 0; index < cursor_; ++index) {
+        if (buffer_[index] == '\\') {
+            ++index;
+        } else if (buffer_[index] == ' ') {
+            word_start = index + 1;
+        }
+    }
+
+    const std::string typed = buffer_.substr(word_start, cursor_ - word_start);
+    const std::string word = unescape_word(typed);
+    const bool command_position =
+        buffer_.find_first_not_of(' ') >= word_start;
+
+    std::string directory_part;
+    bool is_directory = false;
+    Completion completion;
+
+    if (command_position && word.find('/') == std::string::npos) {
+        completion = executables_.complete(word, kCompletionListLimit);
+    } else {
+        const std::size_t slash = word.rfind('/');
+        if (slash != std::string::npos) {
+            directory_part = word.substr(0, slash + 1);
+        }
+        completion = complete_path(word, is_directory);
+    }
+
+    if (completion.candidates.empty()) {
+        write_out("\a");
+        return;
+    }
+
+    const bool unique = completion.candidates.size() == 1 && !completion.truncated;
+
+    std::string replacement = escape_word(directory_part + completion.common_prefix);
+    if (unique) {
+        replacement += is_directory ? "/" : " ";
+    }
+
+    if (replacement != typed) {
+        buffer_.replace(word_start, typed.size(), replacement);
+        cursor_ = word_start + replacement.size();
+        refresh_line();
+        return;
+    }
+
+    if (!list_candidates) {
+        write_out("\a");
+        return;
+    }
+
+    std::string listing = "\r\n";
+    for (const auto& candidate : completion.candidates) {
+        listing += candidate + "  ";
+    }
+    if (completion.truncated) {
+        listing += "...";
+    }
+    listing += "\r\n";
+    write_out(listing);
+    refresh_line();
+}
+
+// User directories under the VFS mount are answered from the in-process user
+// table; going through readdir would round-trip every entry through FUSE.
+Completion LineEditor::complete_path(const std::string& word, bool& is_directory) {
+    const std::size_t slash = word.rfind('/');
+    const std::string directory_part =
+        slash == std::string::npos ? "" : word.substr(0, slash + 1);
+    const std::string base = word.substr(directory_part.size());
+
+    if (directory_part == vfs_mount_path() + "/") {
+        const VfsUserMatches users = find_vfs_users(base, kCompletionListLimit);
+
+        Completion completion;
+        completion.candidates = users.names;
+        completion.common_prefix = users.common_prefix;
+        completion.truncated = users.truncated;
+        is_directory = true;
+        return completion;
+    }
+
+    const std::string directory_path = directory_part.empty() ? "." : directory_part;
+    std::vector<std::string> names;
+
+    DIR* dir = ::opendir(directory_path.c_str());
+    if (dir == nullptr) {
+        return Completion();
+    }
+
+    while (const struct dirent* entry = ::readdir(dir)) {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        if (name.front() == '.' && (base.empty() || base.front() != '.')) {
+            continue;
+        }
+        if (starts_with(name, base)) {
+            names.push_back(name);
+        }
+    }
+    ::closedir(dir);
+
+    std::sort(names.begin(), names.end());
+    Completion completion =
+        collect_sorted_range(names.begin(), names.end(), kCompletionListLimit);
+
+    if (completion.candidates.size() == 1 && !completion.truncated) {
+        struct stat st;
+        const std::string full_path = directory_part + completion.candidates.front();
+        is_directory = ::stat(full_path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    return completion;
+}
+
+std::size_t LineEditor::terminal_columns() {
+    struct winsize size {};
+    if (::ioctl(STDERR_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0) {
+        return size.ws_col;
+    }
+    return 80;
+}
+
+void LineEditor::write_out(const std::string& text) {
+    std::size_t written = 0;
+    while (written < text.size()) {
+        const ssize_t result =
+            ::write(STDERR_FILENO, text.data() + written, text.size() - written);
+        if (result <= 0) {
+            return;
+        }
+        written += static_cast<std::size_t>(result);
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef LINE_EDITOR_H
+#define LINE_EDITOR_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <termios.h>
+
+struct Completion {
+    std::vector<std::string> candidates;
+    std::string common_prefix;
+    bool truncated = false;
+};
+
+// Sorted index of executable names found on $PATH plus the shell builtins.
+// Each directory is rescanned only when $PATH or its mtime changes.
+class ExecutableIndex {
+public:
+    explicit ExecutableIndex(std::vector<std::string> builtins);
+
+    Completion complete(const std::string& prefix, std::size_t limit);
+
+private:
+    struct Directory {
+        std::string path;
+        struct timespec mtime {};
+        bool scanned = false;
+        std::vector<std::string> names;
+    };
+
+    void refresh();
+    static void scan_directory(Directory& directory);
+
+    std::vector<std::string> builtins_;
+    std::string path_value_;
+    std::vector<Directory> directories_;
+    std::vector<std::string> names_;
+};
+
+class LineEditor {
+public:
+    explicit LineEditor(std::string prompt);
+    ~LineEditor();
+
+    bool read_line(std::string& line);
+    void add_history(const std::string& line);
+
+private:
+    bool enable_raw_mode();
+    void disable_raw_mode();
+    bool read_raw_line(std::string& line);
+    void handle_escape_sequence();
+
+    void refresh_line() const;
+    void show_history_entry(std::size_t index);
+    void complete_word(bool list_candidates);
+    Completion complete_path(const std::string& word, bool& is_directory);
+
+    static std::size_t terminal_columns();
+    static void write_out(const std::string& text);
+
+    std::string prompt_;
+    std::string buffer_;
+    std::size_t cursor_ = 0;
+
+    std::vector<std::string> history_;
+    std::size_t history_index_ = 0;
+    std::string pending_line_;
+
+    ExecutableIndex executables_;
+
+    bool raw_mode_ = false;
+    struct termios original_termios_ {};
+};
+
+#endif
@@ -2,18 +2,20 @@
 #include <fstream>
 #include <string>
 #include <vector>
-#include <sstream>
 #include <csignal>
 #include <cstring>
 #include <cstdint>
 #include <cerrno>
+#include <algorithm>
 
 #include <unistd.h>
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 
+#include "line_editor.h"
 #include "vfs.h"
+#include "word_expander.h"
 
 class ShellSignalManager {
 public:
@@ -55,12 +57,12 @@ public:
         }
 
         unsigned char buffer[512];
-        const ssize_t bytes_read = ::read(fd, buffer, sizeof(buffer));
-        ::close(fd);
+        const ssize_t bytes_read = ::pread(fd, buffer, sizeof(buffer), 0);
 
         if (bytes_read != static_cast<ssize_t>(sizeof(buffer))) {
             std::cerr << "Error reading MBR from: " << disk_path
                       << " (read " << bytes_read << " bytes)" << std::endl;
+            ::close(fd);
             return;
         }
 
@@ -70,34 +72,35 @@ public:
                       << std::hex << static_cast<int>(buffer[511])
                       << static_cast<int>(buffer[510])
                       << std::dec << std::endl;
+            ::close(fd);
             return;
         }
 
+        const int partition_table_offset = 0x1BE;
+
+        PartitionEntry entries[4];
+        for (int index = 0; index < 4; ++index) {
+            const unsigned char* raw = buffer + partition_table_offset + index * 16;
+
+            entries[index].status = raw[0];
+            entries[index].type = raw[4];
+            entries[index].lba_start = read_le32(raw + 8);
+            entries[index].sector_count = read_le32(raw + 12);
+        }
+
+        probe_filesystems(fd, entries, 4);
+        ::close(fd);
+
         std::cout << "Disk analysis for: " << disk_path << std::endl;
         std::cout << "Partition table:" << std::endl;
 
         bool bootable_found = false;
         bool is_gpt_protective = false;
 
-        const int partition_table_offset = 0x1BE;
-
         for (int index = 0; index < 4; ++index) {
-            const int offset = partition_table_offset + index * 16;
-
-            const std::uint8_t status = buffer[offset];
-            const std::uint8_t type = buffer[offset + 4];
-
-            const std::uint32_t lba_start =
-                (static_cast<std::uint32_t>(buffer[offset + 11]) << 24) |
-                (static_cast<std::uint32_t>(buffer[offset + 10]) << 16) |
-                (static_cast<std::uint32_t>(buffer[offset + 9]) << 8) |
-                static_cast<std::uint32_t>(buffer[offset + 8]);
-
-            const std::uint32_t sector_count =
-                (static_cast<std::uint32_t>(buffer[offset + 15]) << 24) |
-                (static_cast<std::uint32_t>(buffer[offset + 14]) << 16) |
-                (static_cast<std::uint32_t>(buffer[offset + 13]) << 8) |
-                static_cast<std::uint32_t>(buffer[offset + 12]);
+            const PartitionEntry& entry = entries[index];
+            const std::uint8_t status = entry.status;
+            const std::uint8_t type = entry.type;
 
             std::cout << "Partition " << (index + 1) << ": ";
 
@@ -121,9 +124,9 @@ public:
                 is_gpt_protective = true;
             }
 
-            if (type != 0x00 && sector_count > 0) {
+            if (type != 0x00 && entry.sector_count > 0) {
                 const std::uint64_t size_bytes =
-                    static_cast<std::uint64_t>(sector_count) * 512;
+                    static_cast<std::uint64_t>(entry.sector_count) * 512;
 
                 if (size_bytes >= 1024ull * 1024ull * 1024ull) {
                     std::cout << ", Size: "
@@ -135,7 +138,18 @@ public:
                               << " MB";
                 }
 
-                std::cout << ", Start LBA: " << lba_start;
+                std::cout << ", Start LBA: " << entry.lba_start;
+            }
+
+            if (!entry.filesystem.empty()) {
+                std::cout << ", Filesystem: " << entry.filesystem;
+
+                if (!entry.uuid.empty()) {
+                    std::cout << ", UUID: " << entry.uuid;
+                }
+                if (!entry.label.empty()) {
+                    std::cout << ", Label: " << entry.label;
+                }
             }
 
             std::cout << std::endl;
@@ -153,6 +167,380 @@ public:
     }
 
 private:
+    struct PartitionEntry {
+        std::uint8_t  status = 0;
+        std::uint8_t  type = 0;
+        std::uint32_t lba_start = 0;
+        std::uint32_t sector_count = 0;
+
+        std::string filesystem;
+        std::string uuid;
+        std::string label;
+    };
+
+    // Every supported superblock lies within the first 68 KiB of a partition
+    // (Btrfs and 64 KiB-page swap are the furthest), so one read per
+    // partition suffices.
+    static constexpr std::size_t kProbeWindow = 0x10000 + 0x1000;
+
+    using MetadataReader = void (*)(const unsigned char* window, PartitionEntry& entry);
+
+    // For metadata stored outside the probe window, such as the NTFS label.
+    using ExtraReader = void (*)(int fd,
+                                 std::uint64_t partition_offset,
+                                 const unsigned char* window,
+                                 PartitionEntry& entry);
+
+    struct FilesystemSignature {
+        const char*    name;
+        std::size_t    magic_offset;
+        const char*    magic;
+        std::size_t    magic_length;
+        MetadataReader read_metadata;
+        ExtraReader    read_extra = nullptr;
+    };
+
+    static const FilesystemSignature* signatures(std::size_t& count) {
+        static const FilesystemSignature table[] = {
+            {"crypto_LUKS", 0x0,     "LUKS\xBA\xBE", 6,  &read_luks},
+            {"xfs",         0x0,     "XFSB",         4,  &read_xfs},
+            {"btrfs",       0x10040, "_BHRfS_M",     8,  &read_btrfs},
+            {"ext",         0x438,   "\x53\xEF",     2,  &read_ext},
+            {"swap",        0xFF6,   "SWAPSPACE2",   10, &read_swap},
+            {"swap",        0x1FF6,  "SWAPSPACE2",   10, &read_swap},
+            {"swap",        0x3FF6,  "SWAPSPACE2",   10, &read_swap},
+            {"swap",        0x7FF6,  "SWAPSPACE2",   10, &read_swap},
+            {"swap",        0xFFF6,  "SWAPSPACE2",   10, &read_swap},
+            {"ntfs",        0x3,     "NTFS    ",     8,  &read_ntfs, &read_ntfs_label},
+            {"vfat",        0x52,    "FAT32   ",     8,  &read_fat32},
+            {"vfat",        0x36,    "FAT16   ",     8,  &read_fat16},
+            {"vfat",        0x36,    "FAT12   ",     8,  &read_fat16},
+        };
+        count = sizeof(table) / sizeof(table[0]);
+        return table;
+    }
+
+    // Reads are issued in ascending disk order after the MBR read, so a full
+    // report costs at most five I/Os, plus one per NTFS partition for $Volume.
+    static void probe_filesystems(int fd, PartitionEntry* entries, int entry_count) {
+        std::vector<unsigned char> window(kProbeWindow);
+
+        std::size_t signature_count = 0;
+        const FilesystemSignature* table = signatures(signature_count);
+
+        std::vector<PartitionEntry*> order;
+        for (int index = 0; index < entry_count; ++index) {
+            if (is_probeable(entries[index])) {
+                order.push_back(&entries[index]);
+            }
+        }
+        std::sort(order.begin(), order.end(),
+                  [](const PartitionEntry* lhs, const PartitionEntry* rhs) {
+                      return lhs->lba_start < rhs->lba_start;
+                  });
+
+        for (PartitionEntry* entry : order) {
+            const std::uint64_t partition_bytes =
+                static_cast<std::uint64_t>(entry->sector_count) * 512;
+            const std::size_t length = static_cast<std::size_t>(
+                std::min<std::uint64_t>(kProbeWindow, partition_bytes));
+
+            std::fill(window.begin(), window.end(), 0);
+            const ssize_t bytes_read =
+                ::pread(fd, window.data(), length,
+                        static_cast<off_t>(entry->lba_start) * 512);
+            if (bytes_read <= 0) {
+                continue;
+            }
+
+            for (std::size_t index = 0; index < signature_count; ++index) {
+                const FilesystemSignature& signature = table[index];
+
+                if (signature.magic_offset + signature.magic_length >
+                    static_cast<std::size_t>(bytes_read)) {
+                    continue;
+                }
+                if (std::memcmp(window.data() + signature.magic_offset,
+                                signature.magic, signature.magic_length) != 0) {
+                    continue;
+                }
+
+                entry->filesystem = signature.name;
+                signature.read_metadata(window.data(), *entry);
+                if (signature.read_extra != nullptr) {
+                    signature.read_extra(
+                        fd, static_cast<std::uint64_t>(entry->lba_start) * 512,
+                        window.data(), *entry);
+                }
+                break;
+            }
+        }
+    }
+
+    static bool is_probeable(const PartitionEntry& entry) {
+        switch (entry.type) {
+            case 0x00:
+            case 0x05:
+            case 0x0F:
+            case 0xEE:
+                return false;
+            default:
+                return entry.sector_count > 0;
+        }
+    }
+
+    static void read_ext(const unsigned char* window, PartitionEntry& entry) {
+        const unsigned char* superblock = window + 0x400;
+
+        const std::uint32_t feature_compat = read_le32(superblock + 0x5C);
+        const std::uint32_t feature_incompat = read_le32(superblock + 0x60);
+        const std::uint32_t feature_ro_compat = read_le32(superblock + 0x64);
+
+        // Same rule as blkid: any feature ext3 does not know implies ext4.
+        // ext3 knows ro_compat SPARSE_SUPER, LARGE_FILE and BTREE_DIR, and
+        // incompat FILETYPE, RECOVER and META_BG.
+        const std::uint32_t ext3_ro_compat = 0x1 | 0x2 | 0x4;
+        const std::uint32_t ext3_incompat = 0x2 | 0x4 | 0x10;
+
+        const bool has_journal = (feature_compat & 0x4) != 0;
+        const bool ext4_features =
+            (feature_ro_compat & ~ext3_ro_compat) != 0 ||
+            (feature_incompat & ~ext3_incompat) != 0;
+
+        if (ext4_features) {
+            entry.filesystem = "ext4";
+        } else if (has_journal) {
+            entry.filesystem = "ext3";
+        } else {
+            entry.filesystem = "ext2";
+        }
+
+        entry.uuid = format_uuid(superblock + 0x68);
+        entry.label = read_label(superblock + 0x78, 16);
+    }
+
+    static void read_xfs(const unsigned char* window, PartitionEntry& entry) {
+        entry.uuid = format_uuid(window + 0x20);
+        entry.label = read_label(window + 0x6C, 12);
+    }
+
+    static void read_btrfs(const unsigned char* window, PartitionEntry& entry) {
+        entry.uuid = format_uuid(window + 0x10020);
+        entry.label = read_label(window + 0x1012B, 256);
+    }
+
+    static void read_swap(const unsigned char* window, PartitionEntry& entry) {
+        entry.uuid = format_uuid(window + 0x40C);
+        entry.label = read_label(window + 0x41C, 16);
+    }
+
+    static void read_luks(const unsigned char* window, PartitionEntry& entry) {
+        entry.uuid = read_label(window + 0xA8, 40);
+
+        const std::uint16_t version =
+            static_cast<std::uint16_t>((window[6] << 8) | window[7]);
+        if (version == 2) {
+            entry.label = read_label(window + 0x18, 48);
+        }
+    }
+
+    static void read_ntfs(const unsigned char* window, PartitionEntry& entry) {
+        static const char digits[] = "0123456789ABCDEF";
+
+        for (int index = 7; index >= 0; --index) {
+            entry.uuid += digits[window[0x48 + index] >> 4];
+            entry.uuid += digits[window[0x48 + index] & 0x0F];
+        }
+    }
+
+    // The volume label is the $VOLUME_NAME attribute of MFT record 3 ($Volume).
+    static void read_ntfs_label(int fd,
+                                std::uint64_t partition_offset,
+                                const unsigned char* window,
+                                PartitionEntry& entry) {
+        const std::uint32_t bytes_per_sector = read_le16(window + 0x0B);
+        const std::uint8_t raw_sectors_per_cluster = window[0x0D];
+        const std::uint64_t mft_cluster = read_le64(window + 0x30);
+        const std::int8_t clusters_per_record = static_cast<std::int8_t>(window[0x40]);
+
+        if (bytes_per_sector < 256 || bytes_per_sector > 4096 ||
+            (bytes_per_sector & (bytes_per_sector - 1)) != 0) {
+            return;
+        }
+
+        const std::uint32_t sectors_per_cluster =
+            raw_sectors_per_cluster > 0x80 ? 1u << (256 - raw_sectors_per_cluster)
+                                           : raw_sectors_per_cluster;
+        const std::uint64_t cluster_size =
+            static_cast<std::uint64_t>(bytes_per_sector) * sectors_per_cluster;
+        const std::uint64_t record_size =
+            clusters_per_record > 0 ? clusters_per_record * cluster_size
+                                    : 1ull << (-clusters_per_record);
+
+        if (cluster_size == 0 || record_size < 512 || record_size > 0x10000) {
+            return;
+        }
+
+        std::vector<unsigned char> record(static_cast<std::size_t>(record_size));
+        const std::uint64_t record_offset =
+            partition_offset + mft_cluster * cluster_size + 3 * record_size;
+
+        if (::pread(fd, record.data(), record.size(),
+                    static_cast<off_t>(record_offset)) !=
+            static_cast<ssize_t>(record.size())) {
+            return;
+        }
+        if (std::memcmp(record.data(), "FILE", 4) != 0) {
+            return;
+        }
+
+        // Undo the update sequence: the last two bytes of every 512-byte
+        // stride were swapped for the sequence number on write.
+        const std::uint16_t usa_offset = read_le16(record.data() + 0x04);
+        const std::uint16_t usa_count = read_le16(record.data() + 0x06);
+        if (usa_offset + usa_count * 2u > record.size()) {
+            return;
+        }
+        for (std::uint16_t index = 1; index < usa_count; ++index) {
+            const std::size_t position = index * 512u - 2;
+            if (position + 2 > record.size()) {
+                break;
+            }
+            record[position] = record[usa_offset + index * 2];
+            record[position + 1] = record[usa_offset + index * 2 + 1];
+        }
+
+        std::size_t offset = read_le16(record.data() + 0x14);
+        while (offset + 0x18 <= record.size()) {
+            const std::uint32_t type = read_le32(record.data() + offset);
+            const std::uint32_t length = read_le32(record.data() + offset + 4);
+            if (type == 0xFFFFFFFF || length == 0 || offset + length > record.size()) {
+                return;
+            }
+
+            const bool resident = record[offset + 8] == 0;
+            if (type == 0x60 && resident) {
+                const std::uint32_t value_length = read_le32(record.data() + offset + 0x10);
+                const std::uint16_t value_offset = read_le16(record.data() + offset + 0x14);
+                if (value_offset + value_length > length) {
+                    return;
+                }
+                entry.label = utf16le_to_utf8(record.data() + offset + value_offset,
+                                              value_length / 2);
+                return;
+            }
+
+            offset += length;
+        }
+    }
+
+    static void read_fat32(const unsigned char* window, PartitionEntry& entry) {
+        entry.uuid = format_fat_serial(window + 0x43);
+        entry.label = read_fat_label(window + 0x47);
+    }
+
+    static void read_fat16(const unsigned char* window, PartitionEntry& entry) {
+        entry.uuid = format_fat_serial(window + 0x27);
+        entry.label = read_fat_label(window + 0x2B);
+    }
+
+    static std::uint16_t read_le16(const unsigned char* bytes) {
+        return static_cast<std::uint16_t>((bytes[1] << 8) | bytes[0]);
+    }
+
+    static std::uint64_t read_le64(const unsigned char* bytes) {
+        return (static_cast<std::uint64_t>(read_le32(bytes + 4)) << 32) |
+               read_le32(bytes);
+    }
+
+    static std::string utf16le_to_utf8(const unsigned char* bytes, std::size_t units) {
+        std::string result;
+
+        for (std::size_t index = 0; index < units; ++index) {
+            std::uint32_t code_point = read_le16(bytes + index * 2);
+
+            if (code_point >= 0xD800 && code_point <= 0xDBFF && index + 1 < units) {
+                const std::uint32_t low = read_le16(bytes + (index + 1) * 2);
+                if (low >= 0xDC00 && low <= 0xDFFF) {
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                    ++index;
+                }
+            }
+
+            if (code_point < 0x80) {
+                result += static_cast<char>(code_point);
+            } else if (code_point < 0x800) {
+                result += static_cast<char>(0xC0 | (code_point >> 6));
+                result += static_cast<char>(0x80 | (code_point & 0x3F));
+            } else if (code_point < 0x10000) {
+                result += static_cast<char>(0xE0 | (code_point >> 12));
+                result += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+                result += static_cast<char>(0x80 | (code_point & 0x3F));
+            } else {
+                result += static_cast<char>(0xF0 | (code_point >> 18));
+                result += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+                result += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+                result += static_cast<char>(0x80 | (code_point & 0x3F));
+            }
+        }
+
+        return result;
+    }
+
+    static std::uint32_t read_le32(const unsigned char* bytes) {
+        return (static_cast<std::uint32_t>(bytes[3]) << 24) |
+               (static_cast<std::uint32_t>(bytes[2]) << 16) |
+               (static_cast<std::uint32_t>(bytes[1]) << 8) |
+               static_cast<std::uint32_t>(bytes[0]);
+    }
+
+    static std::string format_uuid(const unsigned char* bytes) {
+        static const char digits[] = "0123456789abcdef";
+
+        std::string uuid;
+        bool all_zero = true;
+        for (int index = 0; index < 16; ++index) {
+            if (index == 4 || index == 6 || index == 8 || index == 10) {
+                uuid += '-';
+            }
+            uuid += digits[bytes[index] >> 4];
+            uuid += digits[bytes[index] & 0x0F];
+            all_zero = all_zero && bytes[index] == 0;
+        }
+
+        return all_zero ? std::string() : uuid;
+    }
+
+    static std::string format_fat_serial(const unsigned char* bytes) {
+        static const char digits[] = "0123456789ABCDEF";
+
+        std::string serial;
+        for (int index = 3; index >= 0; --index) {
+            serial += digits[bytes[index] >> 4];
+            serial += digits[bytes[index] & 0x0F];
+            if (index == 2) {
+                serial += '-';
+            }
+        }
+        return serial;
+    }
+
+    static std::string read_label(const unsigned char* bytes, std::size_t max_length) {
+        std::size_t length = 0;
+        while (length < max_length && bytes[length] != 0) {
+            ++length;
+        }
+        return std::string(reinterpret_cast<const char*>(bytes), length);
+    }
+
+    static std::string read_fat_label(const unsigned char* bytes) {
+        std::string label = read_label(bytes, 11);
+        while (!label.empty() && label.back() == ' ') {
+            label.pop_back();
+        }
+        return label == "NO NAME" ? std::string() : label;
+    }
+
     static std::string partition_type_description(std::uint8_t type) {
         switch (type) {
             case 0x00: return "Empty";
@@ -249,17 +637,21 @@ public:
     }
 
     static void execute_external(const std::string& input) {
-        const pid_t pid = ::fork();
+        WordExpander& expander = WordExpander::instance();
 
-        if (pid == 0) {
-            std::vector<std::string> args;
-            std::stringstream stream(input);
-            std::string token;
+        std::vector<std::string> args;
+        if (!expander.expand(input, args)) {
+            expander.set_last_status(2);
+            return;
+        }
 
-            while (stream >> token) {
-                args.push_back(token);
-            }
+        if (args.empty()) {
+            return;
+        }
+
+        const pid_t pid = ::fork();
 
+        if (pid == 0) {
             std::vector<char*> argv;
             argv.reserve(args.size() + 1);
 
@@ -271,12 +663,18 @@ public:
             ::execvp(argv[0], argv.data());
 
             std::cout << input << ": command not found\n";
-            std::_Exit(1);
+            std::_Exit(127);
         }
 
         if (pid > 0) {
             int status = 0;
             ::waitpid(pid, &status, 0);
+
+            if (WIFEXITED(status)) {
+                expander.set_last_status(WEXITSTATUS(status));
+            } else if (WIFSIGNALED(status)) {
+                expander.set_last_status(128 + WTERMSIG(status));
+            }
         } else {
             std::cerr << "Failed to create process" << '\n';
         }
@@ -287,17 +685,15 @@ class InteractiveShell {
 public:
     InteractiveShell()
         : history_file_path_("kubsh_history.txt"),
-          history_stream_(history_file_path_, std::ios::app) {}
+          history_stream_(history_file_path_, std::ios::app),
+          line_editor_("$ ") {}
 
     void run() {
-        std::cerr << "$ ";
-
         std::string input;
-        while (std::getline(std::cin, input)) {
+        while (line_editor_.read_line(input)) {
             if (ShellSignalManager::is_sighup_received()) {
                 std::cout << "Configuration reloaded" << std::endl;
                 ShellSignalManager::clear_sighup();
-                std::cerr << "$ ";
                 continue;
             }
 
@@ -309,7 +705,6 @@ public:
             }
 
             if (input.empty()) {
-                std::cerr << "$ ";
                 continue;
             }
 
@@ -322,8 +717,6 @@ public:
             } else {
                 ShellCommandExecutor::execute_external(input);
             }
-
-            std::cerr << "$ ";
         }
     }
 
@@ -335,6 +728,8 @@ private:
     }
 
     void append_to_history(const std::string& input) {
+        line_editor_.add_history(input);
+
         if (history_stream_.is_open()) {
             history_stream_ << '$' << input << '\n';
             history_stream_.flush();
@@ -343,6 +738,7 @@ private:
 
     std::string   history_file_path_;
     std::ofstream history_stream_;
+    LineEditor    line_editor_;
 };
 
 int main() {
@@ -17,6 +17,8 @@
 #include <pthread.h>
 #include <ctime>
 #include <algorithm>
+#include <mutex>
+#include <iterator>
 
 class VirtualFileSystem {
 public:
@@ -49,8 +51,7 @@ public:
         (void)fi;
         std::memset(st, 0, sizeof(struct stat));
 
-        const std::time_t now = std::time(nullptr);
-        st->st_atime = st->st_mtime = st->st_ctime = now;
+        st->st_atim = st->st_mtim = st->st_ctim = modified_at_;
 
         if (std::strcmp(path, "/") == 0) {
             st->st_mode = S_IFDIR | 0755;
@@ -204,7 +205,9 @@ public:
                 const int result = std::system(command.c_str());
 
                 if (result == 0) {
+                    std::lock_guard<std::mutex> lock(data_mutex_);
                     vfs_data_.erase(username);
+                    ::clock_gettime(CLOCK_REALTIME, &modified_at_);
                     std::cout << "User " << username << " deleted successfully" << std::endl;
                     return 0;
                 }
@@ -218,42 +221,36 @@ public:
         return -EPERM;
     }
 
-private:
-    VirtualFileSystem() = default;
-
-    static void* run_fuse_thread(void* arg) {
-        (void)arg;
+    // The user table is a sorted map, so all names sharing a prefix form one
+    // contiguous range; its common prefix is that of the first and last keys.
+    VfsUserMatches find_users(const std::string& prefix, std::size_t limit) {
+        VfsUserMatches matches;
+        std::lock_guard<std::mutex> lock(data_mutex_);
 
-        VirtualFileSystem& vfs = VirtualFileSystem::instance();
-        vfs.sync_with_passwd();
-
-        ::mkdir(mount_path().c_str(), 0755);
-
-        const char* argv_local[] = {
-            "kubsh_vfs",
-            mount_path().c_str(),
-            "-f",
-            "-s",
-            nullptr
-        };
-        const int argc_local = 3;
+        const auto first = vfs_data_.lower_bound(prefix);
+        const auto last = upper_bound_for_prefix(prefix);
+        if (first == last) {
+            return matches;
+        }
 
-        static struct fuse_operations operations {};
-        operations.getattr = &VirtualFileSystem::getattr_wrapper;
-        operations.mkdir = &VirtualFileSystem::mkdir_wrapper;
-        operations.rmdir = &VirtualFileSystem::rmdir_wrapper;
-        operations.read = &VirtualFileSystem::read_wrapper;
-        operations.readdir = &VirtualFileSystem::readdir_wrapper;
+        const std::string& front = first->first;
+        const std::string& back = std::prev(last)->first;
+        std::size_t common = 0;
+        while (common < front.size() && common < back.size() &&
+               front[common] == back[common]) {
+            ++common;
+        }
+        matches.common_prefix = front.substr(0, common);
 
-        std::cout << "Mounting VFS at: " << mount_path() << std::endl;
-        const int ret =
-            ::fuse_main(argc_local,
-                        const_cast<char**>(argv_local),
-                        &operations,
-                        nullptr);
-        std::cout << "FUSE exited with code: " << ret << std::endl;
+        for (auto it = first; it != last; ++it) {
+            if (matches.names.size() == limit) {
+                matches.truncated = true;
+                break;
+            }
+            matches.names.push_back(it->first);
+        }
 
-        return nullptr;
+        return matches;
     }
 
     static const std::string& mount_path() {
@@ -261,12 +258,14 @@ private:
         return path;
     }
 
-    void sync_with_passwd() {
+    void sync_with_passwd(const std::string& passwd_path = "/etc/passwd") {
+        std::lock_guard<std::mutex> lock(data_mutex_);
         vfs_data_.clear();
+        ::clock_gettime(CLOCK_REALTIME, &modified_at_);
 
-        std::ifstream passwd_file("/etc/passwd");
+        std::ifstream passwd_file(passwd_path);
         if (!passwd_file.is_open()) {
-            std::cerr << "Cannot open /etc/passwd" << std::endl;
+            std::cerr << "Cannot open " << passwd_path << std::endl;
             return;
         }
 
@@ -298,6 +297,56 @@ private:
         }
     }
 
+private:
+    VirtualFileSystem() = default;
+
+    static void* run_fuse_thread(void* arg) {
+        (void)arg;
+
+        VirtualFileSystem& vfs = VirtualFileSystem::instance();
+        vfs.sync_with_passwd();
+
+        ::mkdir(mount_path().c_str(), 0755);
+
+        const char* argv_local[] = {
+            "kubsh_vfs",
+            mount_path().c_str(),
+            "-f",
+            "-s",
+            nullptr
+        };
+        const int argc_local = 3;
+
+        static struct fuse_operations operations {};
+        operations.getattr = &VirtualFileSystem::getattr_wrapper;
+        operations.mkdir = &VirtualFileSystem::mkdir_wrapper;
+        operations.rmdir = &VirtualFileSystem::rmdir_wrapper;
+        operations.read = &VirtualFileSystem::read_wrapper;
+        operations.readdir = &VirtualFileSystem::readdir_wrapper;
+
+        std::cout << "Mounting VFS at: " << mount_path() << std::endl;
+        const int ret =
+            ::fuse_main(argc_local,
+                        const_cast<char**>(argv_local),
+                        &operations,
+                        nullptr);
+        std::cout << "FUSE exited with code: " << ret << std::endl;
+
+        return nullptr;
+    }
+
+    std::map<std::string, std::map<std::string, std::string>>::iterator
+    upper_bound_for_prefix(std::string prefix) {
+        while (!prefix.empty()) {
+            if (static_cast<unsigned char>(prefix.back()) != 0xFF) {
+                ++prefix.back();
+                return vfs_data_.lower_bound(prefix);
+            }
+            prefix.pop_back();
+        }
+        return vfs_data_.end();
+    }
+
     static int getattr_wrapper(const char* path,
                                struct stat* st,
                                struct fuse_file_info* fi) {
@@ -330,6 +379,11 @@ private:
     }
 
     std::map<std::string, std::map<std::string, std::string>> vfs_data_;
+    std::mutex data_mutex_;
+
+    // Reported as every entry's timestamps so that directory mtimes only move
+    // when the user table does, letting callers cache listings.
+    struct timespec modified_at_ {};
 };
 
 void initialize_vfs() {
@@ -339,3 +393,15 @@ void initialize_vfs() {
 void cleanup_vfs() {
     VirtualFileSystem::instance().cleanup();
 }
+
+const std::string& vfs_mount_path() {
+    return VirtualFileSystem::mount_path();
+}
+
+VfsUserMatches find_vfs_users(const std::string& prefix, std::size_t limit) {
+    return VirtualFileSystem::instance().find_users(prefix, limit);
+}
+
+void load_vfs_users(const std::string& passwd_path) {
+    VirtualFileSystem::instance().sync_with_passwd(passwd_path);
+}
@@ -1,7 +1,21 @@
 #ifndef VFS_H
 #define VFS_H
 
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct VfsUserMatches {
+    std::vector<std::string> names;
+    std::string common_prefix;
+    bool truncated = false;
+};
+
 void initialize_vfs();
 void cleanup_vfs();
 
+const std::string& vfs_mount_path();
+VfsUserMatches find_vfs_users(const std::string& prefix, std::size_t limit);
+void load_vfs_users(const std::string& passwd_path);
+
 #endif
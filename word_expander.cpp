@@ -0,0 +1,688 @@
+#include "word_expander.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <cstring>
+#include <iostream>
+
+#include <dirent.h>
+#include <fnmatch.h>
+#include <pwd.h>
+#include <unistd.h>
+
+namespace {
+
+bool is_glob_char(char c) {
+    return c == '*' || c == '?' || c == '[';
+}
+
+bool has_unescaped_glob(const std::string& component) {
+    for (std::size_t index = 0; index < component.size(); ++index) {
+        if (component[index] == '\\') {
+            ++index;
+        } else if (is_glob_char(component[index])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string unescape(const std::string& component) {
+    std::string result;
+    for (std::size_t index = 0; index < component.size(); ++index) {
+        if (component[index] == '\\' && index + 1 < component.size()) {
+            ++index;
+        }
+        result += component[index];
+    }
+    return result;
+}
+
+bool is_name_start(char c) {
+    return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool is_name_char(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool is_special_parameter(char c) {
+    return std::strchr("?$#@*", c) != nullptr ||
+           std::isdigit(static_cast<unsigned char>(c));
+}
+
+bool is_parameter_name(const std::string& name) {
+    if (name.size() == 1 && is_special_parameter(name.front())) {
+        return true;
+    }
+    if (name.empty() || !is_name_start(name.front())) {
+        return false;
+    }
+    return std::all_of(name.begin(), name.end(), is_name_char);
+}
+
+} // namespace
+
+// Like git's racily clean index entries: directory mtimes may come from a
+// coarse clock, so an entry created in the same tick as the read can leave
+// the mtime unchanged. A listing whose mtime is not older than the read by
+// at least one tick is used once and reread next time. Whole-second mtimes
+// suggest a filesystem with second (or vfat's two-second) granularity.
+bool DirectoryCache::is_racy(const struct timespec& mtime, const struct timespec& read_at) {
+    static const std::int64_t clock_tick_ns = []() {
+        struct timespec resolution {};
+        if (::clock_getres(CLOCK_REALTIME_COARSE, &resolution) != 0) {
+            return std::int64_t{10000000};
+        }
+        return std::int64_t{resolution.tv_sec} * 1000000000 + resolution.tv_nsec;
+    }();
+
+    const std::int64_t granularity_ns =
+        mtime.tv_nsec == 0 ? std::int64_t{2000000000} : clock_tick_ns;
+
+    const std::int64_t mtime_ns =
+        std::int64_t{mtime.tv_sec} * 1000000000 + mtime.tv_nsec;
+    const std::int64_t read_ns =
+        std::int64_t{read_at.tv_sec} * 1000000000 + read_at.tv_nsec;
+
+    return mtime_ns >= read_ns - granularity_ns;
+}
+
+const std::vector<std::string>* DirectoryCache::list(const std::string& path) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return nullptr;
+    }
+
+    const auto key = std::make_pair(st.st_dev, st.st_ino);
+    auto it = listings_.find(key);
+    if (it != listings_.end() && !it->second.racy &&
+        it->second.mtime.tv_sec == st.st_mtim.tv_sec &&
+        it->second.mtime.tv_nsec == st.st_mtim.tv_nsec) {
+        return &it->second.names;
+    }
+
+    struct timespec read_at {};
+    ::clock_gettime(CLOCK_REALTIME, &read_at);
+
+    DIR* dir = ::opendir(path.c_str());
+    if (dir == nullptr) {
+        return nullptr;
+    }
+
+    if (it == listings_.end()) {
+        if (listings_.size() >= kMaxListings) {
+            listings_.clear();
+        }
+        it = listings_.emplace(key, Listing()).first;
+    }
+
+    Listing& listing = it->second;
+    listing.mtime = st.st_mtim;
+    listing.racy = is_racy(st.st_mtim, read_at);
+    listing.names.clear();
+
+    while (const struct dirent* entry = ::readdir(dir)) {
+        if (std::strcmp(entry->d_name, ".") != 0 &&
+            std::strcmp(entry->d_name, "..") != 0) {
+            listing.names.emplace_back(entry->d_name);
+        }
+    }
+    ::closedir(dir);
+
+    std::sort(listing.names.begin(), listing.names.end());
+    return &listing.names;
+}
+
+WordExpander& WordExpander::instance() {
+    static WordExpander expander;
+    return expander;
+}
+
+void WordExpander::set_last_status(int status) {
+    last_status_ = status;
+}
+
+bool WordExpander::expand(const std::string& input, std::vector<std::string>& words) {
+    words.clear();
+
+    Word word;
+    std::size_t index = 0;
+
+    while (index < input.size()) {
+        const char c = input[index];
+
+        if (c == ' ' || c == '\t') {
+            finish_word(word, words);
+            ++index;
+            continue;
+        }
+
+        if (c == '~' && !word.started) {
+            std::string home;
+            if (expand_tilde(input, index, home)) {
+                append(word, home, false);
+                word.started = true;
+                continue;
+            }
+        }
+
+        word.started = true;
+
+        if (c == '\'') {
+            const std::size_t close = input.find('\'', index + 1);
+            if (close == std::string::npos) {
+                std::cerr << "kubsh: unterminated single quote" << '\n';
+                return false;
+            }
+            append(word, input.substr(index + 1, close - index - 1), false);
+            word.quoted = true;
+            index = close + 1;
+        } else if (input.compare(index, 4, "\"$@\"") == 0) {
+            // With no positional parameters "$@" yields no field at all.
+            index += 4;
+        } else if (c == '"') {
+            ++index;
+            std::string text;
+            while (index < input.size() && input[index] != '"') {
+                if (input[index] == '\\' && index + 1 < input.size() &&
+                    std::strchr("$`\"\\", input[index + 1]) != nullptr) {
+                    text += input[index + 1];
+                    index += 2;
+                } else if (input[index] == '$') {
+                    Segments value;
+                    if (!expand_parameter(input, index, true, value)) {
+                        return false;
+                    }
+                    text += concatenate(value);
+                } else {
+                    text += input[index++];
+                }
+            }
+            if (index >= input.size()) {
+                std::cerr << "kubsh: unterminated double quote" << '\n';
+                return false;
+            }
+            append(word, text, false);
+            word.quoted = true;
+            ++index;
+        } else if (c == '\\') {
+            if (index + 1 < input.size()) {
+                append(word, std::string(1, input[index + 1]), false);
+                index += 2;
+            } else {
+                append(word, "\\", false);
+                ++index;
+            }
+        } else if (c == '$') {
+            Segments value;
+            if (!expand_parameter(input, index, false, value)) {
+                return false;
+            }
+            append_expansion(word, value, words);
+        } else {
+            append(word, std::string(1, c), true);
+            ++index;
+        }
+    }
+
+    finish_word(word, words);
+    return true;
+}
+
+// Supports $NAME, ${NAME}, the special parameters ? $ # 0 and the
+// positional ones, which are always unset in kubsh. Inside braces the
+// -, :-, =, :=, + and :+ operators and ${#NAME} are accepted; anything else
+// is rejected as a bad substitution. A lone '$' is kept literally.
+bool WordExpander::expand_parameter(const std::string& input,
+                                    std::size_t& index,
+                                    bool in_double_quotes,
+                                    Segments& value) {
+    const std::size_t start = index + 1;
+    value.assign(1, Segment());
+    std::string& text = value.front().text;
+
+    if (start >= input.size()) {
+        ++index;
+        text = "$";
+        return true;
+    }
+
+    if (is_special_parameter(input[start])) {
+        index = start + 1;
+        lookup_parameter(std::string(1, input[start]), text);
+        return true;
+    }
+
+    if (is_name_start(input[start])) {
+        std::size_t end = start;
+        while (end < input.size() && is_name_char(input[end])) {
+            ++end;
+        }
+        lookup_parameter(input.substr(start, end - start), text);
+        index = end;
+        return true;
+    }
+
+    if (input[start] != '{') {
+        ++index;
+        text = "$";
+        return true;
+    }
+
+    // Find the matching '}', skipping quoted and escaped characters.
+    std::size_t close = start + 1;
+    bool in_inner_quotes = false;
+    for (int depth = 1; close < input.size(); ++close) {
+        const char c = input[close];
+        if (c == '\\') {
+            ++close;
+        } else if (c == '\'' && !in_double_quotes && !in_inner_quotes) {
+            close = input.find('\'', close + 1);
+            if (close == std::string::npos) {
+                close = input.size();
+                break;
+            }
+        } else if (c == '"') {
+            in_inner_quotes = !in_inner_quotes;
+        } else if (in_inner_quotes) {
+            continue;
+        } else if (c == '{') {
+            ++depth;
+        } else if (c == '}' && --depth == 0) {
+            break;
+        }
+    }
+
+    const std::string body = input.substr(start + 1, close - start - 1);
+    if (close >= input.size()) {
+        std::cerr << "kubsh: ${" << body << ": bad substitution" << '\n';
+        return false;
+    }
+    index = close + 1;
+
+    const auto bad_substitution = [&body]() {
+        std::cerr << "kubsh: ${" << body << "}: bad substitution" << '\n';
+        return false;
+    };
+
+    if (body.size() > 1 && body.front() == '#') {
+        const std::string name = body.substr(1);
+        if (!is_parameter_name(name)) {
+            return bad_substitution();
+        }
+        std::string parameter;
+        lookup_parameter(name, parameter);
+        text = std::to_string(parameter.size());
+        return true;
+    }
+
+    std::size_t name_end = 0;
+    if (!body.empty() && is_name_start(body.front())) {
+        while (name_end < body.size() && is_name_char(body[name_end])) {
+            ++name_end;
+        }
+    } else if (!body.empty() && std::isdigit(static_cast<unsigned char>(body.front()))) {
+        while (name_end < body.size() &&
+               std::isdigit(static_cast<unsigned char>(body[name_end]))) {
+            ++name_end;
+        }
+    } else if (!body.empty() && is_special_parameter(body.front())) {
+        name_end = 1;
+    }
+
+    if (name_end == 0) {
+        return bad_substitution();
+    }
+
+    const std::string name = body.substr(0, name_end);
+    std::string operation = body.substr(name_end);
+
+    const bool is_set = lookup_parameter(name, text);
+    if (operation.empty()) {
+        return true;
+    }
+
+    const bool check_null = operation.front() == ':';
+    if (check_null) {
+        operation.erase(operation.begin());
+    }
+    if (operation.empty() || std::strchr("-=+", operation.front()) == nullptr) {
+        return bad_substitution();
+    }
+
+    const char op = operation.front();
+    const bool use_alternative =
+        op == '+' ? (is_set && !(check_null && text.empty()))
+                  : (!is_set || (check_null && text.empty()));
+
+    if (!use_alternative) {
+        if (op == '+') {
+            text.clear();
+        }
+        return true;
+    }
+
+    if (op == '=' && !is_name_start(name.front())) {
+        return bad_substitution();
+    }
+
+    Segments word;
+    if (!expand_nested_word(operation.substr(1), in_double_quotes, word)) {
+        return false;
+    }
+
+    if (op == '=') {
+        // As in sh, the result is the assigned value, subject to splitting.
+        const std::string assigned = concatenate(word);
+        ::setenv(name.c_str(), assigned.c_str(), 1);
+        value.assign(1, Segment{assigned, false});
+        return true;
+    }
+
+    value = word;
+    return true;
+}
+
+// The word of ${NAME:-word}. Quotes and backslashes are removed here, and
+// the pieces they protected are marked quoted so the caller neither
+// field-splits nor globs them. Inside double quotes everything is quoted
+// and single quotes are literal, as in sh.
+bool WordExpander::expand_nested_word(const std::string& text,
+                                      bool in_double_quotes,
+                                      Segments& result) {
+    result.clear();
+
+    const auto add = [&result](const std::string& piece, bool quoted) {
+        if (!result.empty() && result.back().quoted == quoted) {
+            result.back().text += piece;
+        } else {
+            result.push_back(Segment{piece, quoted});
+        }
+    };
+
+    std::size_t index = 0;
+    while (index < text.size()) {
+        const char c = text[index];
+
+        if (c == '\\' && index + 1 < text.size()) {
+            if (in_double_quotes && std::strchr("$`\"\\}", text[index + 1]) == nullptr) {
+                add("\\", true);
+                ++index;
+            } else {
+                add(std::string(1, text[index + 1]), true);
+                index += 2;
+            }
+        } else if (c == '\'' && !in_double_quotes) {
+            const std::size_t close = text.find('\'', index + 1);
+            if (close == std::string::npos) {
+                std::cerr << "kubsh: unterminated single quote" << '\n';
+                return false;
+            }
+            add(text.substr(index + 1, close - index - 1), true);
+            index = close + 1;
+        } else if (c == '"') {
+            ++index;
+            std::string quoted;
+            while (index < text.size() && text[index] != '"') {
+                if (text[index] == '\\' && index + 1 < text.size() &&
+                    std::strchr("$`\"\\", text[index + 1]) != nullptr) {
+                    quoted += text[index + 1];
+                    index += 2;
+                } else if (text[index] == '$') {
+                    Segments value;
+                    if (!expand_parameter(text, index, true, value)) {
+                        return false;
+                    }
+                    quoted += concatenate(value);
+                } else {
+                    quoted += text[index++];
+                }
+            }
+            if (index >= text.size()) {
+                std::cerr << "kubsh: unterminated double quote" << '\n';
+                return false;
+            }
+            add(quoted, true);
+            ++index;
+        } else if (c == '$') {
+            Segments value;
+            if (!expand_parameter(text, index, in_double_quotes, value)) {
+                return false;
+            }
+            for (const auto& segment : value) {
+                add(segment.text, in_double_quotes || segment.quoted);
+            }
+        } else {
+            add(std::string(1, c), in_double_quotes);
+            ++index;
+        }
+    }
+    return true;
+}
+
+std::string WordExpander::concatenate(const Segments& segments) {
+    std::string text;
+    for (const auto& segment : segments) {
+        text += segment.text;
+    }
+    return text;
+}
+
+// Returns whether the parameter is set; there are no positional parameters.
+bool WordExpander::lookup_parameter(const std::string& name, std::string& value) const {
+    value.clear();
+
+    if (name == "?") {
+        value = std::to_string(last_status_);
+    } else if (name == "$") {
+        value = std::to_string(::getpid());
+    } else if (name == "#") {
+        value = "0";
+    } else if (name == "0") {
+        value = "kubsh";
+    } else if (name == "@" || name == "*" ||
+               std::isdigit(static_cast<unsigned char>(name.front()))) {
+        return false;
+    } else {
+        const char* env_value = std::getenv(name.c_str());
+        if (env_value == nullptr) {
+            return false;
+        }
+        value = env_value;
+    }
+    return true;
+}
+
+bool WordExpander::expand_tilde(const std::string& input, std::size_t& index, std::string& result) {
+    std::size_t end = index + 1;
+    while (end < input.size() && input[end] != '/' &&
+           input[end] != ' ' && input[end] != '\t') {
+        const char c = input[end];
+        if (!is_name_char(c) && c != '.' && c != '-') {
+            return false;
+        }
+        ++end;
+    }
+
+    const std::string user = input.substr(index + 1, end - index - 1);
+
+    if (user.empty()) {
+        const char* home = std::getenv("HOME");
+        if (home != nullptr) {
+            result = home;
+        } else {
+            const struct passwd* entry = ::getpwuid(::getuid());
+            if (entry == nullptr) {
+                return false;
+            }
+            result = entry->pw_dir;
+        }
+    } else {
+        const struct passwd* entry = ::getpwnam(user.c_str());
+        if (entry == nullptr) {
+            return false;
+        }
+        result = entry->pw_dir;
+    }
+
+    index = end;
+    return true;
+}
+
+// text is the word after quote removal; pattern is the same word with quoted
+// glob characters backslash-escaped, ready for fnmatch.
+void WordExpander::append(Word& word, const std::string& text, bool glob_active) {
+    word.text += text;
+
+    for (const char c : text) {
+        if (glob_active && is_glob_char(c)) {
+            word.has_glob = true;
+        } else if (is_glob_char(c) || c == '\\') {
+            word.pattern += '\\';
+        }
+        word.pattern += c;
+    }
+}
+
+void WordExpander::append_expansion(Word& word,
+                                    const Segments& value,
+                                    std::vector<std::string>& words) {
+    for (const auto& segment : value) {
+        if (segment.quoted) {
+            append(word, segment.text, false);
+            word.quoted = true;
+            word.started = true;
+        } else {
+            append_fields(word, segment.text, words);
+        }
+    }
+}
+
+// Unquoted expansion results are split on $IFS (default space, tab and
+// newline) following POSIX field splitting: runs of IFS whitespace separate
+// fields and are trimmed at the ends, while each other IFS character ends a
+// field, so "a::b" with IFS=: yields an empty middle field.
+void WordExpander::append_fields(Word& word,
+                                 const std::string& value,
+                                 std::vector<std::string>& words) {
+    const char* ifs_env = std::getenv("IFS");
+    const std::string ifs = ifs_env != nullptr ? ifs_env : " \t\n";
+
+    bool ended_by_whitespace = false;
+    for (const char c : value) {
+        if (ifs.find(c) == std::string::npos) {
+            append(word, std::string(1, c), true);
+            word.started = true;
+            ended_by_whitespace = false;
+        } else if (c == ' ' || c == '\t' || c == '\n') {
+            const bool had_content = !word.text.empty() || word.quoted;
+            finish_word(word, words);
+            ended_by_whitespace = ended_by_whitespace || had_content;
+        } else if (ended_by_whitespace && !word.started) {
+            ended_by_whitespace = false;
+        } else {
+            finish_word(word, words, true);
+        }
+    }
+}
+
+void WordExpander::finish_word(Word& word, std::vector<std::string>& words, bool keep_empty) {
+    if (!word.started && !keep_empty) {
+        return;
+    }
+
+    bool matched = false;
+    if (word.has_glob) {
+        const std::size_t before = words.size();
+        glob(word.pattern, words);
+        matched = words.size() > before;
+    }
+
+    if (!matched && (!word.text.empty() || word.quoted || keep_empty)) {
+        words.push_back(word.text);
+    }
+
+    word = Word();
+}
+
+void WordExpander::glob(const std::string& pattern, std::vector<std::string>& matches) {
+    std::vector<std::string> components;
+    std::size_t start = 0;
+    while (start <= pattern.size()) {
+        std::size_t end = pattern.find('/', start);
+        if (end == std::string::npos) {
+            end = pattern.size();
+        }
+        components.push_back(pattern.substr(start, end - start));
+        start = end + 1;
+    }
+
+    const bool trailing_slash = components.size() > 1 && components.back().empty();
+    if (trailing_slash) {
+        components.pop_back();
+    }
+
+    std::vector<std::string> bases(1);
+    std::size_t first = 0;
+    if (!pattern.empty() && pattern.front() == '/') {
+        bases.front() = "/";
+        first = 1;
+    }
+
+    bool literal_tail = false;
+    for (std::size_t index = first; index < components.size(); ++index) {
+        const std::string& component = components[index];
+        if (component.empty()) {
+            continue;
+        }
+
+        const bool last = index + 1 == components.size();
+        const std::string separator = last ? "" : "/";
+        std::vector<std::string> next;
+
+        if (has_unescaped_glob(component)) {
+            for (const auto& base : bases) {
+                const std::vector<std::string>* names =
+                    directory_cache_.list(base.empty() ? "." : base);
+                if (names == nullptr) {
+                    continue;
+                }
+
+                for (const auto& name : *names) {
+                    if (::fnmatch(component.c_str(), name.c_str(), FNM_PERIOD) == 0) {
+                        next.push_back(base + name + separator);
+                    }
+                }
+            }
+            literal_tail = false;
+        } else {
+            const std::string literal = unescape(component);
+            for (const auto& base : bases) {
+                next.push_back(base + literal + separator);
+            }
+            literal_tail = true;
+        }
+
+        bases.swap(next);
+        if (bases.empty()) {
+            return;
+        }
+    }
+
+    for (auto& base : bases) {
+        struct stat st;
+        if (trailing_slash) {
+            if (::stat(base.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+                continue;
+            }
+            base += '/';
+        } else if (literal_tail && ::lstat(base.c_str(), &st) != 0) {
+            continue;
+        }
+        matches.push_back(base);
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef WORD_EXPANDER_H
+#define WORD_EXPANDER_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+// Sorted directory listings keyed by (device, inode). An entry is reused
+// until the directory's mtime changes, so repeated globs skip readdir. A
+// listing read too soon after the last change is not trusted; see is_racy.
+class DirectoryCache {
+public:
+    const std::vector<std::string>* list(const std::string& path);
+
+private:
+    struct Listing {
+        struct timespec mtime {};
+        bool racy = false;
+        std::vector<std::string> names;
+    };
+
+    static bool is_racy(const struct timespec& mtime, const struct timespec& read_at);
+
+    static const std::size_t kMaxListings = 256;
+
+    std::map<std::pair<dev_t, ino_t>, Listing> listings_;
+};
+
+// Performs parameter expansion, tilde expansion, field splitting of unquoted
+// expansions, quote removal and pathname globbing on a command line.
+class WordExpander {
+public:
+    static WordExpander& instance();
+
+    bool expand(const std::string& input, std::vector<std::string>& words);
+    void set_last_status(int status);
+
+private:
+    struct Word {
+        std::string text;
+        std::string pattern;
+        bool has_glob = false;
+        bool quoted = false;
+        bool started = false;
+    };
+
+    // A piece of an expansion result; quoted pieces are neither field-split
+    // nor globbed.
+    struct Segment {
+        std::string text;
+        bool quoted = false;
+    };
+    using Segments = std::vector<Segment>;
+
+    WordExpander() = default;
+
+    bool expand_parameter(const std::string& input,
+                          std::size_t& index,
+                          bool in_double_quotes,
+                          Segments& value);
+    bool expand_nested_word(const std::string& text, bool in_double_quotes, Segments& result);
+    static std::string concatenate(const Segments& segments);
+    bool lookup_parameter(const std::string& name, std::string& value) const;
+    static bool expand_tilde(const std::string& input, std::size_t& index, std::string& result);
+
+    static void append(Word& word, const std::string& text, bool glob_active);
+    void append_expansion(Word& word, const Segments& value, std::vector<std::string>& words);
+    void append_fields(Word& word, const std::string& value, std::vector<std::string>& words);
+    void finish_word(Word& word, std::vector<std::string>& words, bool keep_empty = false);
+    void glob(const std::string& pattern, std::vector<std::string>& matches);
+
+    DirectoryCache directory_cache_;
+    int last_status_ = 0;
+};
+
+#endif